@@ -0,0 +1,26 @@
+#ifndef DATA_GEN_H
+#define DATA_GEN_H
+
+#include <stddef.h>
+
+// input distributions the generator can produce
+enum InputDistribution {
+    DIST_UNIFORM,       // uniform random values in [0, 2^31-1] (same range as random())
+    DIST_SORTED,        // already sorted ascending
+    DIST_REVERSE,       // sorted descending
+    DIST_FEW_UNIQUE,    // only a handful of distinct keys (lots of duplicates)
+    DIST_NEARLY_SORTED  // sorted, with ~1% of elements replaced by random values
+};
+
+// parallel input generation. element i only depends on (seed, i) so the output is
+// identical for any number of generator threads
+int* make_input_array(size_t size, enum InputDistribution dist, unsigned long long seed, int p);
+void fill_input_array(int* arr, size_t size, enum InputDistribution dist, unsigned long long seed, int p);
+
+// order independent hash of the multiset of values in arr (same for any permutation)
+unsigned long long multiset_hash(const int* arr, size_t size, int p);
+
+// parallel verification: returns 1 if arr is sorted and its multiset hash equals expected_hash
+int verify_sorted_permutation(const int* arr, size_t size, unsigned long long expected_hash, int p);
+
+#endif
@@ -2,18 +2,22 @@
 #define PSRS_INTERNAL_H
 
 #include <pthread.h>
+#include <stddef.h>
 
 // thread control block sturcture (TCB)
 struct ThreadControlBlock {
     int id;
     int* local_array;  // pointer to this threads portion of data
-    int local_size;
+    size_t local_size;
+    size_t num_blocks; // phase 1 sorts local_array in sorted blocks of PHASE1_BLOCK_SIZE (not merged until phase 3)
     int* samples;      // samples for phase 2
+    size_t num_samples; // oversampling * p (less if local_size is smaller)
+    size_t* block_bounds; // phase 3 split points, p + 1 per block (piece p of block b is [b*(p+1)+p, b*(p+1)+p+1))
 };
 
 // Global Variables (shared across files)
 extern int* global_arr;
-extern int global_size;
+extern size_t global_size;
 extern int num_threads;
 extern pthread_t* thread_ids;
 extern struct ThreadControlBlock* TCB;
@@ -23,13 +27,43 @@ extern pthread_barrier_t barrier;
 extern int* pivots;
 extern int num_pivots;
 
+// oversampling / load balance (phase 2 & 3 stuff)
+extern int oversampling_factor;     // samples per thread = oversampling_factor * p
+extern double imbalance_threshold;  // resample if max/avg partition size goes above this
+extern int run_oversampling;        // oversampling used by the current run (grows when resampling)
+extern int num_resamples;
+extern double run_imbalance;        // achieved max/avg partition size
+extern int resample_flag;
+
+// ints per phase 1 block: 64K ints = 256KB so a block stays in L2 while qsort works on it
+#ifndef PHASE1_BLOCK_SIZE
+#define PHASE1_BLOCK_SIZE 65536
+#endif
+
+// max samples phase 2 takes from the sorted blocks of one chunk before picking its regular samples
+#define PHASE2_MAX_CANDIDATES 1048576
+// min samples phase 2 takes from a full block (so there are enough to pick regular samples from, even at small p)
+#define PHASE2_BLOCK_CANDIDATES 256
+
+// max times phase 2+3 are redone, and how much oversampling grows each time
+#define MAX_RESAMPLES 2
+#define RESAMPLE_GROWTH 4
+// above this many samples pivots are picked in parallel instead of by master qsort
+#define SAMPLE_SORT_THRESHOLD 65536
+
 // Partition arrays ,each thread makes p partitions
 extern int*** partitions;
-extern int** partition_sizes;
+extern size_t** partition_sizes;
 
 // final merged arrays for each thread 
 extern int** final_arrays;
-extern int* final_sizes;
+extern size_t* final_sizes;
+
+// merge api stuff (psrs_merge_runs, input is k already sorted runs)
+extern int** merge_runs;
+extern size_t* merge_sizes;
+extern int merge_k;
+extern int* merge_out;
 
 // phase timing (for benchmarking)
 extern double phase1_time;
@@ -37,19 +71,72 @@ extern double phase2_time;
 extern double phase3_time;
 extern double phase4_time;
 
+// i * n / d without overflowing (i * n can go past 64 bits for arrays above 2^32 elements)
+static inline size_t mul_div(size_t i, size_t n, size_t d) {
+    return (size_t)(((unsigned __int128)i * n) / d);
+}
+
+// phase 1 chunk of thread_id is [chunk_start, chunk_end) of the n elements (last thread gets any remaining elements)
+static inline size_t chunk_start(int thread_id, size_t n, int p) {
+    return (size_t)thread_id * (n / p);
+}
+static inline size_t chunk_end(int thread_id, size_t n, int p) {
+    return (thread_id == p - 1) ? n : (size_t)(thread_id + 1) * (n / p);
+}
+
+// phase 1 blocks of a chunk of local_n elements: how many, and the length of block b (last one can be shorter)
+static inline size_t chunk_num_blocks(size_t local_n) {
+    return (local_n + PHASE1_BLOCK_SIZE - 1) / PHASE1_BLOCK_SIZE;
+}
+static inline size_t block_length(size_t b, size_t local_n) {
+    size_t block_start = b * PHASE1_BLOCK_SIZE;
+    return (block_start + PHASE1_BLOCK_SIZE <= local_n) ? PHASE1_BLOCK_SIZE : local_n - block_start;
+}
+
+// phase 2: regular samples ("candidates") taken from the blocks of a chunk. a full block gets num_samples of them,
+// at least PHASE2_BLOCK_CANDIDATES (fewer if the chunk would go over PHASE2_MAX_CANDIDATES, but always at least
+// num_samples in total)
+static inline size_t chunk_candidates(size_t num_samples, size_t num_blocks) {
+    size_t per_block = (num_samples > PHASE2_BLOCK_CANDIDATES) ? num_samples : PHASE2_BLOCK_CANDIDATES;
+    size_t total = per_block * num_blocks;
+    if(total > PHASE2_MAX_CANDIDATES) {
+        total = PHASE2_MAX_CANDIDATES;
+        if(total < num_samples + num_blocks) total = num_samples + num_blocks;
+    }
+    return total;
+}
+// candidates of one block: proportional to its length (so a short last block doesnt count as much as a full
+// one), at least 1
+static inline size_t block_candidates(size_t block_n, size_t total_candidates, size_t local_n) {
+    size_t count = mul_div(block_n, total_candidates, local_n);
+    return (count > 0) ? count : 1;
+}
+
 // barrier macro
 #define BARRIER pthread_barrier_wait(&barrier)
 
 // Phase functions
 void phase1_local_sort(int thread_id);
 void phase2_select_pivots(int thread_id);
+void phase3_split_blocks(int thread_id);
+int phase3_check_balance(int thread_id);
+void phase3_free_split(int thread_id);
 void phase3_partition(int thread_id);
 void phase4_merge(int thread_id);
 
+// merge api functions (phase 1 is skipped, runs are already sorted)
+void merge_select_pivots(int thread_id);
+void merge_split_and_merge(int thread_id);
+
 // SPMD main
 void* spmd_main(void* arg);
+void* merge_spmd_main(void* arg);
 
 // comparision function
 int compare_ints(const void* a, const void* b);
 
+// sorted run helpers (psrs_utils.c)
+size_t upper_bound_int(int* run, size_t n, int pivot);
+void kway_merge(int** runs, size_t* start, size_t* end, int k, int* out);
+
 #endif
@@ -1,13 +1,19 @@
 #ifndef SORT_H
 #define SORT_H
 
-int* sort(int*arr, int sizeofarray);
-int* psrs(int* arr, int sizeofarray);
+#include <stddef.h>
+
+int* sort(int*arr, size_t sizeofarray);
+int* psrs(int* arr, size_t sizeofarray);
+int* psrs_merge_runs(int** runs, size_t* sizes, int k, int* out);
 void set_num_threads(int p);
+void set_oversampling(int factor, double threshold);
 int compare_ints(const void* a, const void* b);
 
 // phase timing functions (for benchmarking)
 void get_phase_times(double* p1, double* p2, double* p3, double* p4);
 void reset_phase_times();
+// load balance of last psrs / psrs_merge_runs call (max/avg partition size, oversampling it ended up using)
+void get_balance_stats(double* imbalance, int* oversampling_used);
 
 #endif
\ No newline at end of file
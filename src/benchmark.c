@@ -5,8 +5,11 @@
 #include <stdlib.h>
 #include <sys/time.h>
 #include "sort.h"
+#include "data_gen.h"
 #define TOTAL_RUNS 7
 #define RUNS_TO_AVG 5
+#define INPUT_SEED 67
+#define GEN_THREADS 16  // threads used to generate / verify inputs (not timed)
 
 // struct to hold all timing info
 struct RunResultPsrs {
@@ -15,40 +18,29 @@ struct RunResultPsrs {
     double p2_time;
     double p3_time;
     double p4_time;
+    double imbalance;  // max/avg partition size (from first run)
 };
 
-int* make_random_array(int size) {
-    int* arr = (int*)malloc(size * sizeof(int));
-    for(int i = 0; i < size; i++) {
-        arr[i] = random();
-    }
-    return arr;
-}
-
-int is_sorted(int* arr, int n) {
-    for(int i = 0; i < n-1; i++) {
-        if(arr[i] > arr[i+1]) return 0;
-    }
-    return 1;
-}
-
 double get_time() {
     struct timeval tv;
     gettimeofday(&tv, NULL);
     return tv.tv_sec + tv.tv_usec / 1000000.0;
 }
 
-struct RunResultPsrs run_parallel(int n, int p) {
+struct RunResultPsrs run_parallel(size_t n, int p) {
     double times[TOTAL_RUNS];
     double p1_times[TOTAL_RUNS];
     double p2_times[TOTAL_RUNS];
     double p3_times[TOTAL_RUNS];
     double p4_times[TOTAL_RUNS];
+    double imbalance = 1.0;
     
     // do 7 runs
     for(int run = 0; run < TOTAL_RUNS; run++) {
-        srandom(67);
-        int* arr = make_random_array(n);
+        int* arr = make_input_array(n, DIST_UNIFORM, INPUT_SEED, GEN_THREADS);
+        // hash of input, to check output is a permutation of it (only first run)
+        unsigned long long input_hash = 0;
+        if(run == 0) input_hash = multiset_hash(arr, n, GEN_THREADS);
         
         // reset phase times before run
         reset_phase_times();
@@ -64,9 +56,14 @@ struct RunResultPsrs run_parallel(int n, int p) {
         // get phase times
         get_phase_times(&p1_times[run], &p2_times[run], &p3_times[run], &p4_times[run]);
         
-        // verify its sorted (only first run)
         if(run == 0) {
-            if(!is_sorted(arr, n)) {
+            int oversampling_used;
+            get_balance_stats(&imbalance, &oversampling_used);
+        }
+        
+        // verify its sorted and nothing was lost/duplicated (only first run)
+        if(run == 0) {
+            if(!verify_sorted_permutation(arr, n, input_hash, GEN_THREADS)) {
                 printf("error :(");
             }
         }
@@ -75,7 +72,7 @@ struct RunResultPsrs run_parallel(int n, int p) {
     }
     
     // average last 5 runs
-    struct RunResultPsrs result = {0, 0, 0, 0, 0};
+    struct RunResultPsrs result = {0, 0, 0, 0, 0, imbalance};
     for(int i = TOTAL_RUNS - RUNS_TO_AVG; i < TOTAL_RUNS; i++) {
         result.total_time += times[i];
         result.p1_time += p1_times[i];
@@ -93,12 +90,11 @@ struct RunResultPsrs run_parallel(int n, int p) {
 }
 
 // run sequential qsort for comparison
-double run_sequential(int n) {
+double run_sequential(size_t n) {
     double times[TOTAL_RUNS];
     
     for(int run = 0; run < TOTAL_RUNS; run++) {
-        srandom(67);
-        int* arr = make_random_array(n);
+        int* arr = make_input_array(n, DIST_UNIFORM, INPUT_SEED, GEN_THREADS);
         
         double start = get_time();
         // use qsort directly for sequential baseline
@@ -120,7 +116,7 @@ double run_sequential(int n) {
 
 int main() {
     // a.
-    int sizes[] = {32000000, 48000000, 64000000, 96000000, 128000000, 164000000};
+    size_t sizes[] = {32000000, 48000000, 64000000, 96000000, 128000000, 164000000};
     int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
     int threads[] = {2, 4, 8, 12, 16, 32, 64, 128};
     int num_threads_to_test = sizeof(threads) / sizeof(threads[0]);
@@ -142,13 +138,13 @@ int main() {
     }
     fprintf(time_file, "\n");
     fprintf(speedup_file, "\n");
-    fprintf(phase_file, "n,p,total,phase1,phase2,phase3,phase4\n");
+    fprintf(phase_file, "n,p,total,phase1,phase2,phase3,phase4,imbalance\n");
     
     // c.
     // run experiments for each array size
     for(int s = 0; s < num_sizes; s++) {
-        int n = sizes[s];
-        printf("testing n = %d\n", n);
+        size_t n = sizes[s];
+        printf("testing n = %zu\n", n);
         
         // 1. first get sequential time
         printf(" running sequential qsort...\n");
@@ -168,22 +164,22 @@ int main() {
             
             printf("  Time: %.4f sec, Speedup: %.2fx\n", 
                    result.total_time, seq_time / result.total_time);
-            printf("    Phase breakdown: P1=%.4f P2=%.4f P3=%.4f P4=%.4f\n",
-                   result.p1_time, result.p2_time, result.p3_time, result.p4_time);
+            printf("    Phase breakdown: P1=%.4f P2=%.4f P3=%.4f P4=%.4f (balance %.3f)\n",
+                   result.p1_time, result.p2_time, result.p3_time, result.p4_time, result.imbalance);
             
             // write phase breakdown to file
-            fprintf(phase_file, "%d,%d,%.6f,%.6f,%.6f,%.6f,%.6f\n",
+            fprintf(phase_file, "%zu,%d,%.6f,%.6f,%.6f,%.6f,%.6f,%.4f\n",
                     n, p, result.total_time, 
-                    result.p1_time, result.p2_time, result.p3_time, result.p4_time);
+                    result.p1_time, result.p2_time, result.p3_time, result.p4_time, result.imbalance);
         }
         
         // 3. write log fiels
-        fprintf(time_file, "%d,%.6f", n, seq_time);
+        fprintf(time_file, "%zu,%.6f", n, seq_time);
         for(int t = 0; t < num_threads_to_test; t++) {
             fprintf(time_file, ",%.6f", parallel_times[t]);
         }
         fprintf(time_file, "\n");
-        fprintf(speedup_file, "%d", n);
+        fprintf(speedup_file, "%zu", n);
         for(int t = 0; t < num_threads_to_test; t++) {
             fprintf(speedup_file, ",%.4f", seq_time / parallel_times[t]);
         }
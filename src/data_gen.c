@@ -0,0 +1,156 @@
+// parallel input generation and output verification (used by benchmark.c and main.c)
+// generator is counter based: value i = mix(seed, i), so every thread can fill its own
+// chunk without sharing rng state and the array is the same no matter how many threads made it
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "data_gen.h"
+
+// args for one generator / verifier thread
+struct DataWorker {
+    int* arr;
+    size_t size;   // size of the whole array (some distributions depend on it)
+    size_t start;
+    size_t end;
+    enum InputDistribution dist;
+    unsigned long long seed;
+    unsigned long long hash;  // partial multiset hash (output)
+    int sorted;               // 1 if chunk is in order (output)
+};
+
+// splitmix64 finalizer (citation: https://prng.di.unimi.it/splitmix64.c)
+static unsigned long long mix64(unsigned long long z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// counter based rng: random 64 bits for element i of stream 'seed'
+static unsigned long long rand_at(unsigned long long seed, unsigned long long i) {
+    return mix64(seed + (i + 1) * 0x9e3779b97f4a7c15ULL);
+}
+
+// value at position i of an ascending ramp over [0, 2^31-1]
+static int ramp_at(size_t i, size_t size) {
+    return (int)(((unsigned __int128)i << 31) / size);  // 128 bit so i << 31 cant overflow
+}
+
+static int value_at(enum InputDistribution dist, unsigned long long seed, size_t i, size_t size) {
+    unsigned long long r = rand_at(seed, i);
+    switch(dist) {
+        case DIST_SORTED:
+            return ramp_at(i, size);
+        case DIST_REVERSE:
+            return ramp_at(size - 1 - i, size);
+        case DIST_FEW_UNIQUE:
+            return (int)((r >> 33) % 16) * (0x7fffffff / 16);
+        case DIST_NEARLY_SORTED:
+            // low bits pick which ~1% get replaced, high bits are the new value
+            if((r & 0xffff) % 100 == 0) return (int)(r >> 33);
+            return ramp_at(i, size);
+        case DIST_UNIFORM:
+        default:
+            return (int)(r >> 33);  // 31 bits, same range as random()
+    }
+}
+
+static void* fill_worker(void* arg) {
+    struct DataWorker* w = (struct DataWorker*)arg;
+    for(size_t i = w->start; i < w->end; i++) {
+        w->arr[i] = value_at(w->dist, w->seed, i, w->size);
+    }
+    return NULL;
+}
+
+static void* hash_worker(void* arg) {
+    struct DataWorker* w = (struct DataWorker*)arg;
+    unsigned long long h = 0;
+    for(size_t i = w->start; i < w->end; i++) {
+        h += mix64((unsigned long long)(unsigned int)w->arr[i]);  // addition is order independent
+    }
+    w->hash = h;
+    return NULL;
+}
+
+static void* verify_worker(void* arg) {
+    struct DataWorker* w = (struct DataWorker*)arg;
+    hash_worker(arg);
+    // also compare last element of my chunk with first element of the next one
+    w->sorted = 1;
+    for(size_t i = w->start; i < w->end && i + 1 < w->size; i++) {
+        if(w->arr[i] > w->arr[i+1]) {
+            w->sorted = 0;
+            break;
+        }
+    }
+    return NULL;
+}
+
+// split [0, size) into p chunks and run fn on each one (main thread does chunk 0)
+static void run_workers(struct DataWorker* workers, int p, void* (*fn)(void*)) {
+    pthread_t* ids = (pthread_t*)malloc(p * sizeof(pthread_t));
+    for(int t = 1; t < p; t++) {
+        pthread_create(&ids[t], NULL, fn, (void*)&workers[t]);
+    }
+    fn((void*)&workers[0]);
+    for(int t = 1; t < p; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    free(ids);
+}
+
+static struct DataWorker* make_workers(int* arr, size_t size, int p) {
+    struct DataWorker* workers = (struct DataWorker*)calloc(p, sizeof(struct DataWorker));
+    size_t chunk_size = size / p;
+    for(int t = 0; t < p; t++) {
+        workers[t].arr = arr;
+        workers[t].size = size;
+        workers[t].start = t * chunk_size;
+        workers[t].end = (t == p - 1) ? size : (t + 1) * chunk_size;
+    }
+    return workers;
+}
+
+void fill_input_array(int* arr, size_t size, enum InputDistribution dist, unsigned long long seed, int p) {
+    if(p < 1) p = 1;
+    struct DataWorker* workers = make_workers(arr, size, p);
+    for(int t = 0; t < p; t++) {
+        workers[t].dist = dist;
+        workers[t].seed = seed;
+    }
+    run_workers(workers, p, fill_worker);
+    free(workers);
+}
+
+int* make_input_array(size_t size, enum InputDistribution dist, unsigned long long seed, int p) {
+    int* arr = (int*)malloc(size * sizeof(int));
+    fill_input_array(arr, size, dist, seed, p);
+    return arr;
+}
+
+unsigned long long multiset_hash(const int* arr, size_t size, int p) {
+    if(p < 1) p = 1;
+    struct DataWorker* workers = make_workers((int*)arr, size, p);
+    run_workers(workers, p, hash_worker);
+    unsigned long long h = 0;
+    for(int t = 0; t < p; t++) {
+        h += workers[t].hash;
+    }
+    free(workers);
+    return h;
+}
+
+int verify_sorted_permutation(const int* arr, size_t size, unsigned long long expected_hash, int p) {
+    if(p < 1) p = 1;
+    struct DataWorker* workers = make_workers((int*)arr, size, p);
+    run_workers(workers, p, verify_worker);
+    unsigned long long h = 0;
+    int sorted = 1;
+    for(int t = 0; t < p; t++) {
+        h += workers[t].hash;
+        if(!workers[t].sorted) sorted = 0;
+    }
+    free(workers);
+    return sorted && h == expected_hash;
+}
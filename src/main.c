@@ -6,33 +6,32 @@ this code and file was mainly to test psrs and qsort codes that i wrote. benchma
 #include <stdlib.h>
 #include <sys/time.h>
 #include "sort.h"
-
-// generate random array with random values
-int* generateRandomArray(int sizeofarray) {
-    int* arr = (int*) malloc(sizeofarray * sizeof(int));
-    for(int i = 0; i < sizeofarray; i++) {
-        arr[i] = random(); 
-    }
-    return arr;
-}
+#include "data_gen.h"
 
 // main function
 int main(int argc, char** argv) {
-    int n = 1000000;  // default array size (if i dont give input via terminal)
+    size_t n = 1000000;  // default array size (if i dont give input via terminal)
     int p = 4;        // default number of threads(if i dont give input via terminal)
+    enum InputDistribution dist = DIST_UNIFORM; // 3rd arg: 0 uniform, 1 sorted, 2 reverse, 3 few unique, 4 nearly sorted
     if(argc >= 2) {
-        n = atoi(argv[1]);
+        n = strtoull(argv[1], NULL, 10);  // can be above 2^31
     }
     if(argc >= 3) {
         p = atoi(argv[2]);
     }
+    if(argc >= 4) {
+        dist = (enum InputDistribution)atoi(argv[3]);
+    }
+    if(argc >= 5) {
+        set_oversampling(atoi(argv[4]), 1.3);  // 4th arg: oversampling factor
+    }
     
     printf("psrs starting ... \n");
 
     // set threads and array bfr running psrs
     set_num_threads(p);
-    srandom(67); 
-    int* arr = generateRandomArray(n);
+    int* arr = make_input_array(n, dist, 67, p);
+    unsigned long long input_hash = multiset_hash(arr, n, p);
     
     // psrs
     struct timeval start_time, end_time; // (using timeval as time_t was not working will and not too high resolution...)
@@ -45,6 +44,46 @@ int main(int argc, char** argv) {
                      (end_time.tv_usec - start_time.tv_usec) / 1000000.0;
     
     printf("Sorting completed in %.6f seconds\n", elapsed);
+    double imbalance;
+    int oversampling_used;
+    get_balance_stats(&imbalance, &oversampling_used);
+    printf("Partition balance (max/avg): %.3f with oversampling %d\n", imbalance, oversampling_used);
+    if(verify_sorted_permutation(arr, n, input_hash, p)) {
+        printf("output verified (sorted + same elements as input)\n");
+    } else {
+        printf("error: output is not a sorted permutation of the input\n");
+    }
+    free(arr);
+    
+    // merge api test: cut a fresh input into k shards, sort each shard, then merge them
+    int k = 8;
+    arr = make_input_array(n, dist, 67, p);
+    int** runs = (int**)malloc(k * sizeof(int*));
+    size_t* run_sizes = (size_t*)malloc(k * sizeof(size_t));
+    for(int r = 0; r < k; r++) {
+        size_t shard_start = (r * n) / k;
+        size_t shard_end = ((r + 1) * n) / k;
+        runs[r] = &arr[shard_start];
+        run_sizes[r] = shard_end - shard_start;
+        sort(runs[r], run_sizes[r]);
+    }
+    int* merged = (int*)malloc(n * sizeof(int));
+    gettimeofday(&start_time, NULL);
+    psrs_merge_runs(runs, run_sizes, k, merged);
+    gettimeofday(&end_time, NULL);
+    elapsed = (end_time.tv_sec - start_time.tv_sec) + 
+              (end_time.tv_usec - start_time.tv_usec) / 1000000.0;
+    printf("Merging %d sorted shards completed in %.6f seconds\n", k, elapsed);
+    get_balance_stats(&imbalance, &oversampling_used);
+    printf("Merge balance (max/avg): %.3f\n", imbalance);
+    if(verify_sorted_permutation(merged, n, input_hash, p)) {
+        printf("merge output verified\n");
+    } else {
+        printf("error: merge output is not a sorted permutation of the input\n");
+    }
+    free(merged);
+    free(runs);
+    free(run_sizes);
     free(arr);
     
     return 0;
@@ -14,7 +14,7 @@ double phase4_time = 0.0;
 
 //global vasrs for psrs
 int* global_arr = NULL;
-int global_size = 0;
+size_t global_size = 0;
 int num_threads = 4;  
 pthread_t* thread_ids = NULL;
 struct ThreadControlBlock* TCB = NULL;
@@ -24,16 +24,30 @@ pthread_barrier_t barrier;
 int* pivots = NULL;
 int num_pivots = 0;
 
+// oversampling and load balance (phase 2 & 3 stuff)
+int oversampling_factor = 1;        // 1 = plain psrs (p samples per thread)
+double imbalance_threshold = 1.3;
+int run_oversampling = 1;
+int num_resamples = 0;
+double run_imbalance = 1.0;
+int resample_flag = 0;
+
 // partition arrays (phase 3 stuff)
 // note: i put these out of tcb strct as in phase 3, all threds need to access other thread partions. so this is not 'strictly' thread related
 int*** partitions = NULL;  // partitions[thread][partition][elements]
-int** partition_sizes = NULL;  // sizes of each partition
+size_t** partition_sizes = NULL;  // sizes of each partition
 // final merged arrays for each thread  (phase 4 stuff)
 int** final_arrays = NULL; // 2d cz threads, partitions
-int* final_sizes = NULL; // size of all rows in final arrasys
+size_t* final_sizes = NULL; // size of all rows in final arrasys
+
+// merge api (psrs_merge_runs) stuff
+int** merge_runs = NULL;  // k sorted input runs
+size_t* merge_sizes = NULL;  // size of each run
+int merge_k = 0;
+int* merge_out = NULL;    // output array (sum of sizes elements)
 
 // Main PSRS function 
-int* psrs(int* arr, int sizeofarray) {
+int* psrs(int* arr, size_t sizeofarray) {
     // setup the barrier
     pthread_barrier_init(&barrier, NULL, num_threads);
     global_arr = arr;
@@ -44,10 +58,15 @@ int* psrs(int* arr, int sizeofarray) {
     thread_ids = (pthread_t*)malloc(num_threads * sizeof(pthread_t));
     // allocate partition arrays
     partitions = (int***)malloc(num_threads * sizeof(int**));
-    partition_sizes = (int**)malloc(num_threads * sizeof(int*));
+    partition_sizes = (size_t**)malloc(num_threads * sizeof(size_t*));
     // allocate final output arrays
     final_arrays = (int**)malloc(num_threads * sizeof(int*));
-    final_sizes = (int*)malloc(num_threads * sizeof(int));
+    final_sizes = (size_t*)malloc(num_threads * sizeof(size_t));
+    // pivots (phase 2 fills them in, maybe more than once if we resample)
+    num_pivots = num_threads - 1;
+    pivots = (int*)malloc((num_pivots > 0 ? num_pivots : 1) * sizeof(int));
+    run_oversampling = (oversampling_factor > 0) ? oversampling_factor : 1;
+    num_resamples = 0;
     
     //start threads 1 to p-1 (main thread will be thread 0)
     for(int i = 1; i < num_threads; i++) {
@@ -65,9 +84,9 @@ int* psrs(int* arr, int sizeofarray) {
     }
     
     // copy final sorted data back into original array
-    int position = 0;
+    size_t position = 0;
     for(int t = 0; t < num_threads; t++) {
-        for(int i = 0; i < final_sizes[t]; i++) {
+        for(size_t i = 0; i < final_sizes[t]; i++) {
             arr[position++] = final_arrays[t][i];
         }
     }
@@ -90,16 +109,92 @@ int* psrs(int* arr, int sizeofarray) {
     free(final_arrays);
     free(final_sizes);
     if(pivots) free(pivots);
+    pivots = NULL;
     pthread_barrier_destroy(&barrier);
     
     return arr;
 }
 
+// merge k already sorted runs into out (out must hold sum of sizes elements, and not overlap the runs)
+// skips phase 1: samples the runs for pivots, then every thread merges its pivot range of all runs in parallel
+int* psrs_merge_runs(int** runs, size_t* sizes, int k, int* out) {
+    // no phase 1 or 3 here, so clear them (phase 2 & 4 are set by merge_spmd_main) instead of keeping the last psrs times
+    phase1_time = 0.0;
+    phase2_time = 0.0;
+    phase3_time = 0.0;
+    phase4_time = 0.0;
+    run_oversampling = (oversampling_factor > 0) ? oversampling_factor : 1;
+    
+    size_t total_n = 0;
+    for(int r = 0; r < k; r++) {
+        total_n += sizes[r];
+    }
+    if(total_n == 0) {
+        run_imbalance = 1.0;  // nothing to merge, nothing unbalanced
+        return out;
+    }
+    
+    pthread_barrier_init(&barrier, NULL, num_threads);
+    merge_runs = runs;
+    merge_sizes = sizes;
+    merge_k = k;
+    merge_out = out;
+    
+    TCB = (struct ThreadControlBlock*)malloc(num_threads * sizeof(struct ThreadControlBlock));
+    thread_ids = (pthread_t*)malloc(num_threads * sizeof(pthread_t));
+    final_sizes = (size_t*)malloc(num_threads * sizeof(size_t));
+    // pivots (filled in by merge_select_pivots)
+    num_pivots = num_threads - 1;
+    pivots = (int*)malloc((num_pivots > 0 ? num_pivots : 1) * sizeof(int));
+    
+    //start threads 1 to p-1 (main thread will be thread 0)
+    for(int i = 1; i < num_threads; i++) {
+        TCB[i].id = i;
+        pthread_create(&thread_ids[i], NULL, merge_spmd_main, (void*)&TCB[i]);
+    }
+    TCB[0].id = 0;
+    merge_spmd_main((void*)&TCB[0]);
+    for(int i = 1; i < num_threads; i++) {
+        pthread_join(thread_ids[i], NULL);
+    }
+    
+    // balance stats (max/avg elements merged per thread), same as get_balance_stats for psrs
+    size_t max_size = 0;
+    for(int t = 0; t < num_threads; t++) {
+        if(final_sizes[t] > max_size) max_size = final_sizes[t];
+    }
+    run_imbalance = (double)max_size / ((double)total_n / num_threads);
+    
+    // cleanup
+    free(TCB);
+    free(thread_ids);
+    free(final_sizes);
+    final_sizes = NULL;
+    if(pivots) free(pivots);
+    pivots = NULL;
+    pthread_barrier_destroy(&barrier);
+    
+    return out;
+}
+
 // function to set number of threads (callable from main)
 void set_num_threads(int p) {
     num_threads = p;
 }
 
+// function to set oversampling (samples per thread = factor * p) and the max/avg partition
+// size ratio above which phase 2 & 3 are redone with more samples
+void set_oversampling(int factor, double threshold) {
+    oversampling_factor = factor;
+    imbalance_threshold = threshold;
+}
+
+// function to get load balance of the last psrs run
+void get_balance_stats(double* imbalance, int* oversampling_used) {
+    *imbalance = run_imbalance;
+    *oversampling_used = run_oversampling;
+}
+
 // function to get phase times (for benchmarking)
 void get_phase_times(double* p1, double* p2, double* p3, double* p4) {
     *p1 = phase1_time;
@@ -0,0 +1,78 @@
+// merge api: k-way merge of already sorted runs using the psrs pivot/partition idea
+// phase 1 is skipped (runs are sorted already), pivots come from regular samples of the runs,
+// each thread binary searches its pivot range in every run and merges its pieces straight into merge_out
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pthread_barrier.h"
+#include "psrs_internal.h"
+
+// merge pivots: master regular samples every run at its own quantiles (like phase 2 does for each block),
+// with the number of samples proportional to the run size so every sample stands for about the same number of
+// elements. then the samples are sorted and pivots are picked every total/p samples
+void merge_select_pivots(int thread_id) {
+    if(thread_id == 0) {
+        size_t total_n = 0;
+        for(int r = 0; r < merge_k; r++) {
+            total_n += merge_sizes[r];
+        }
+        
+        // an average sized run gets oversampling * p * p samples
+        size_t target = (size_t)merge_k * num_threads * num_threads * (oversampling_factor > 0 ? oversampling_factor : 1);
+        if(target > PHASE2_MAX_CANDIDATES) target = PHASE2_MAX_CANDIDATES;
+        size_t* run_samples = (size_t*)malloc(merge_k * sizeof(size_t));
+        size_t total_samples = 0;
+        for(int r = 0; r < merge_k; r++) {
+            // round up so every non empty run gets at least 1 sample
+            run_samples[r] = (merge_sizes[r] > 0) ? mul_div(merge_sizes[r], target, total_n) + 1 : 0;
+            total_samples += run_samples[r];
+        }
+        
+        int* all_samples = (int*)malloc(total_samples * sizeof(int));
+        size_t index = 0;
+        for(int r = 0; r < merge_k; r++) {
+            for(size_t j = 0; j < run_samples[r]; j++) {
+                // regular sampling at the middle of each of the equal parts (so few samples per run dont lean low)
+                all_samples[index++] = merge_runs[r][mul_div(2 * j + 1, merge_sizes[r], 2 * run_samples[r])];
+            }
+        }
+        
+        qsort(all_samples, total_samples, sizeof(int), compare_ints);
+        
+        // choose p-1 pivots evenly spaced (same as phase 2)
+        for(int i = 0; i < num_pivots; i++) {
+            pivots[i] = all_samples[mul_div(i + 1, total_samples, num_threads)];
+        }
+        
+        free(all_samples);
+        free(run_samples);
+    }
+    
+    BARRIER;  // wait for master to finish
+}
+
+// each thread finds its piece of every run (binary search on the pivots) and merges them into merge_out
+void merge_split_and_merge(int thread_id) {
+    // a. split points: my piece of run r is [start[r], end[r])
+    size_t* start = (size_t*)malloc(merge_k * sizeof(size_t));
+    size_t* end = (size_t*)malloc(merge_k * sizeof(size_t));
+    size_t out_offset = 0;  // everything before my piece in every run comes before me in the output
+    size_t my_size = 0;
+    for(int r = 0; r < merge_k; r++) {
+        size_t n = merge_sizes[r];
+        start[r] = (thread_id == 0) ? 0 : upper_bound_int(merge_runs[r], n, pivots[thread_id - 1]);
+        end[r] = (thread_id == num_threads - 1) ? n : upper_bound_int(merge_runs[r], n, pivots[thread_id]);
+        out_offset += start[r];
+        my_size += end[r] - start[r];
+    }
+    final_sizes[thread_id] = my_size;  // for the balance stats
+    
+    // b. k-way merge of the pieces
+    kway_merge(merge_runs, start, end, merge_k, merge_out + out_offset);
+    
+    free(start);
+    free(end);
+    
+    BARRIER;
+}
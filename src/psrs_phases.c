@@ -1,4 +1,5 @@
-// citation: https://www.geeksforgeeks.org/dsa/merge-k-sorted-arrays/ (for some part of logic in phase 4)
+// citation: https://www.geeksforgeeks.org/dsa/merge-k-sorted-arrays/ (for some part of logic in the phase 4 merge loop.
+// the heap merge phase 3 uses is kway_merge in psrs_utils.c, which has its own citation)
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,115 +10,256 @@
 // phase 1: each thread sorts its local portion
 void phase1_local_sort(int thread_id) {
     // calculate which part of array belongs to this thread
-    int chunk_size = global_size / num_threads;  // 10 elems per thread=30 size/3 threads
-    int start = thread_id * chunk_size; // could be 0, 10, 20 for this mind example
-    int end; // could be 30, 10, 20 (this is inflated by 1)
-    // last thread gets any remaining elements
-    if(thread_id == num_threads - 1) {
-        end = global_size;
-    } else {
-        end = start + chunk_size;
-    }
-    int local_n = end - start;
+    // (10 elems per thread=30 size/3 threads, start could be 0, 10, 20 and end 10, 20, 30 for this mind example)
+    size_t start = chunk_start(thread_id, global_size, num_threads);
+    size_t end = chunk_end(thread_id, global_size, num_threads);
+    size_t local_n = end - start;
     
-    // sort my chunk using quicksort
-    qsort(&global_arr[start], local_n, sizeof(int), compare_ints);
+    // sort my chunk in cache sized blocks using quicksort (each block fits in L2 while its sorted)
+    // the blocks are not merged here, phase 3 merges them straight into the partitions
+    size_t num_blocks = chunk_num_blocks(local_n);
+    for(size_t b = 0; b < num_blocks; b++) {
+        size_t block_start = start + b * PHASE1_BLOCK_SIZE;
+        qsort(&global_arr[block_start], block_length(b, local_n), sizeof(int), compare_ints);
+    }
     
     // save pointer and size to TCB
     TCB[thread_id].local_array = &global_arr[start];
     TCB[thread_id].local_size = local_n;
+    TCB[thread_id].num_blocks = num_blocks;
+}
+
+// number of samples <= value, summed over every thread's (sorted) sample list (for the parallel pivot search)
+static size_t count_samples_le(int value) {
+    size_t count = 0;
+    for(int t = 0; t < num_threads; t++) {
+        size_t lo = 0, hi = TCB[t].num_samples;
+        while(lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if(TCB[t].samples[mid] <= value) lo = mid + 1;
+            else hi = mid;
+        }
+        count += lo;
+    }
+    return count;
 }
 
 //phase 2, pick pivots to partition data
 void phase2_select_pivots(int thread_id) {
-    // a. each thread takes p samples from its sorted portion
-    int local_n = TCB[thread_id].local_size;
-    TCB[thread_id].samples = (int*)malloc(num_threads * sizeof(int));
+    // a. each thread takes run_oversampling * p samples from its portion
+    size_t local_n = TCB[thread_id].local_size;
+    size_t wanted = (size_t)run_oversampling * num_threads;
+    size_t num_samples = (wanted < local_n) ? wanted : local_n;
+    TCB[thread_id].samples = (int*)malloc((num_samples > 0 ? num_samples : 1) * sizeof(int));
+    TCB[thread_id].num_samples = num_samples;
     // (regular sampling)
-    for(int i = 0; i < num_threads; i++) {
-        // formula for regular sampling: divide array into equal parts
-        int sample_index = (i * local_n) / num_threads;  // its values will be 0 , 3, 9  for p1 (local sample idices for all threads)
-        // make sure we dont go out of bounds
-        if(sample_index >= local_n) {
-            sample_index = local_n - 1;
+    // the chunk is only sorted per block, so first regular sample every block with a number of candidates
+    // proportional to its length (a full block gets num_samples or more, see chunk_candidates), sort those candidates,
+    // then take num_samples regular samples of them. with a single block this is plain regular sampling:
+    // 0, 3, 9 for p1 (local sample idices for all threads)
+    size_t num_blocks = TCB[thread_id].num_blocks;
+    size_t total_candidates = chunk_candidates(num_samples, num_blocks);
+    size_t max_candidates = total_candidates + num_blocks;  // +1 per block for rounding up to at least 1
+    int* candidates = (int*)malloc((max_candidates > 0 ? max_candidates : 1) * sizeof(int));
+    size_t num_candidates = 0;
+    for(size_t b = 0; b < num_blocks; b++) {
+        size_t block_start = b * PHASE1_BLOCK_SIZE;
+        size_t block_n = block_length(b, local_n);
+        size_t count = block_candidates(block_n, total_candidates, local_n);
+        for(size_t j = 0; j < count; j++) {
+            // formula for regular sampling: divide block into equal parts. block b starts b/num_blocks of a part
+            // later, so the candidates of all blocks together land on evenly spread quantiles (instead of every
+            // block giving its min, its 1/count quantile, ... which bunch up after sorting)
+            size_t offset = mul_div(j * num_blocks + b, block_n, count * num_blocks);
+            candidates[num_candidates++] = TCB[thread_id].local_array[block_start + offset];
         }
-        TCB[thread_id].samples[i] = TCB[thread_id].local_array[sample_index];
     }
+    if(num_blocks > 1) {
+        qsort(candidates, num_candidates, sizeof(int), compare_ints);
+    }
+    for(size_t i = 0; i < num_samples; i++) {
+        TCB[thread_id].samples[i] = candidates[mul_div(i, num_candidates, num_samples)];
+    }
+    free(candidates);
     
     BARRIER; 
     
-    // b. master does pivot selection
-    if(thread_id == 0) {
-        // 1.gather all the samples from all threads
-        int total_samples = num_threads * num_threads;
-        int* all_samples = (int*)malloc(total_samples * sizeof(int));
-        int index = 0;
-        for(int t = 0; t < num_threads; t++) {
-            for(int s = 0; s < num_threads; s++) {
-                all_samples[index] = TCB[t].samples[s];
-                index++;
+    size_t total_samples = 0;
+    for(int t = 0; t < num_threads; t++) {
+        total_samples += TCB[t].num_samples;
+    }
+    
+    if(total_samples <= SAMPLE_SORT_THRESHOLD) {
+        // b. master does pivot selection
+        if(thread_id == 0) {
+            // 1.gather all the samples from all threads
+            int* all_samples = (int*)malloc((total_samples > 0 ? total_samples : 1) * sizeof(int));
+            size_t index = 0;
+            for(int t = 0; t < num_threads; t++) {
+                for(size_t s = 0; s < TCB[t].num_samples; s++) {
+                    all_samples[index] = TCB[t].samples[s];
+                    index++;
+                }
+            }
+            
+            // 2.sort all samples together
+            qsort(all_samples, total_samples, sizeof(int), compare_ints);
+            
+            // 3.choose p-1 pivots (evenly spaced, every total/p samples. with oversampling 1 this is every p samples as in the psrs paper)
+            for(int i = 0; i < num_pivots; i++) {
+                size_t position = mul_div(i + 1, total_samples, num_threads);
+                pivots[i] = (total_samples > 0) ? all_samples[position] : 0;
+            }
+            
+            free(all_samples);
+        }
+    } else {
+        // b. large sample set: dont sort it at all. every thread's samples are already sorted (sorted in
+        // step a), so thread i finds pivot i directly as the k-th smallest sample by binary searching
+        // the value range. all p-1 pivots get picked in parallel
+        if(thread_id < num_pivots) {
+            size_t rank = mul_div(thread_id + 1, total_samples, num_threads);
+            long long lo = -2147483648LL, hi = 2147483647LL;
+            // smallest value with more than 'rank' samples <= it
+            while(lo < hi) {
+                long long mid = lo + (hi - lo) / 2;
+                if(count_samples_le((int)mid) > rank) hi = mid;
+                else lo = mid + 1;
             }
+            pivots[thread_id] = (int)lo;
         }
+    }
+    
+    BARRIER;  // wait for pivots to be picked
+}
+
+// phase3, partition the data according to pivots
+// the chunk is still a list of sorted blocks (phase 1), so every block is split with binary search on the
+// pivots and partition p is the multiway merge of piece p of every block (this is the local merge too).
+// split first: the split points already give every partition size, so the balance check (and any resample)
+// happens before anything is allocated or merged
+void phase3_split_blocks(int thread_id) {
+    size_t local_n = TCB[thread_id].local_size;
+    size_t num_blocks = TCB[thread_id].num_blocks;
+    
+    // a. split points: partition p of block b is [bounds[b][p], bounds[b][p+1])
+    size_t* bounds = (size_t*)malloc((num_blocks > 0 ? num_blocks : 1) * (num_threads + 1) * sizeof(size_t));
+    partition_sizes[thread_id] = (size_t*)calloc(num_threads, sizeof(size_t));
+    for(size_t b = 0; b < num_blocks; b++) {
+        int* block = &TCB[thread_id].local_array[b * PHASE1_BLOCK_SIZE];
+        size_t block_n = block_length(b, local_n);
+        size_t* block_bounds = &bounds[b * (num_threads + 1)];
+        block_bounds[0] = 0;
+        for(int p = 0; p < num_pivots; p++) {
+            // pivots are sorted so only search after the previous split point
+            block_bounds[p + 1] = block_bounds[p] + upper_bound_int(block + block_bounds[p], block_n - block_bounds[p], pivots[p]);
+        }
+        block_bounds[num_threads] = block_n;
         
-        // 2.sort all samples together
-        qsort(all_samples, total_samples, sizeof(int), compare_ints);
+        // b. partition sizes straight from the split points
+        for(int p = 0; p < num_threads; p++) {
+            partition_sizes[thread_id][p] += block_bounds[p + 1] - block_bounds[p];
+        }
+    }
+    TCB[thread_id].block_bounds = bounds;
+    
+    BARRIER;
+}
+
+// after the split: master checks max/avg partition size. if its too skewed (and more samples could fix it)
+// every thread is told to redo phase 2 & the split with more oversampling. returns 1 if we should resample
+int phase3_check_balance(int thread_id) {
+    if(thread_id == 0) {
+        size_t max_size = 0;
+        int heaviest = 0;
+        for(int p = 0; p < num_threads; p++) {
+            size_t size = 0;
+            for(int t = 0; t < num_threads; t++) {
+                size += partition_sizes[t][p];
+            }
+            if(size > max_size) {
+                max_size = size;
+                heaviest = p;
+            }
+        }
+        double avg_size = (double)global_size / num_threads;
+        run_imbalance = (avg_size > 0) ? max_size / avg_size : 1.0;
         
-        // 3.choose p-1 pivots (evenly spaced)
-        num_pivots = num_threads - 1;
-        pivots = (int*)malloc(num_pivots * sizeof(int));
+        // more samples than elements in a chunk wont help (all elems already sampled)
+        int can_grow = (size_t)run_oversampling * num_threads < global_size / num_threads;
         
-        for(int i = 0; i < num_pivots; i++) {
-            // skip 'num_threads' samples between each pivot
-            int position = (i + 1) * num_threads;
-            
-            // make sure we don't go past the end (this logic sometimes picks one more pivot at the end i.e., last sample, that might not be very helpful. but as in psrs paper, if oversampling is not of order n/p, its fine)
-            if(position >= total_samples) {
-                position = total_samples - 1;
+        // more samples also wont help if the skew comes from one key: a pivot value that repeats means one key
+        // already covers more than a partition, and a heaviest partition holding a single value cant be split
+        int can_fix = 1;
+        for(int i = 1; i < num_pivots; i++) {
+            if(pivots[i] == pivots[i - 1]) can_fix = 0;
+        }
+        int have_value = 0;
+        int min_value = 0, max_value = 0;
+        for(int t = 0; t < num_threads; t++) {
+            for(size_t b = 0; b < TCB[t].num_blocks; b++) {
+                size_t* block_bounds = &TCB[t].block_bounds[b * (num_threads + 1)];
+                size_t start = block_bounds[heaviest];
+                size_t end = block_bounds[heaviest + 1];
+                if(start == end) continue;
+                // each block is sorted, so the first and last elements of its piece are the piece's min and max
+                int* block = &TCB[t].local_array[b * PHASE1_BLOCK_SIZE];
+                if(!have_value || block[start] < min_value) min_value = block[start];
+                if(!have_value || block[end - 1] > max_value) max_value = block[end - 1];
+                have_value = 1;
             }
-            
-            // pick the pivot value at that position
-            pivots[i] = all_samples[position];
         }
+        if(have_value && min_value == max_value) can_fix = 0;
         
-        free(all_samples);
+        resample_flag = run_imbalance > imbalance_threshold && num_resamples < MAX_RESAMPLES && can_grow && can_fix;
+        if(resample_flag) {
+            num_resamples++;
+            run_oversampling *= RESAMPLE_GROWTH;
+        }
     }
     
-    BARRIER;  // wait for master to finish
+    BARRIER;  // everyone needs to see resample_flag
+    return resample_flag;
 }
 
-// phase3, partition the data according to pivots
+// free this threads phase 2 samples and split points (before resampling)
+void phase3_free_split(int thread_id) {
+    free(TCB[thread_id].samples);
+    TCB[thread_id].samples = NULL;
+    free(TCB[thread_id].block_bounds);
+    TCB[thread_id].block_bounds = NULL;
+    free(partition_sizes[thread_id]);
+    partition_sizes[thread_id] = NULL;
+}
+
+// merge piece p of every block into partition p, with the final pivots (exact size, so no worst case allocation)
 void phase3_partition(int thread_id) {
-    int local_n = TCB[thread_id].local_size;
-    int* local_data = TCB[thread_id].local_array;
+    int num_blocks = (int)TCB[thread_id].num_blocks;
+    size_t* bounds = TCB[thread_id].block_bounds;
     
-    // a. allocate p partitions for this thread
     partitions[thread_id] = (int**)malloc(num_threads * sizeof(int*));
-    partition_sizes[thread_id] = (int*)malloc(num_threads * sizeof(int));
-    // alocate memory for each partition 
-    // worst case all elements go into 1 partition so allocate local_n for each ...
-    for(int p = 0; p < num_threads; p++) {
-        partitions[thread_id][p] = (int*)malloc(local_n * sizeof(int));
-        partition_sizes[thread_id][p] = 0;
+    int** blocks = (int**)malloc((num_blocks > 0 ? num_blocks : 1) * sizeof(int*));
+    size_t* start = (size_t*)malloc((num_blocks > 0 ? num_blocks : 1) * sizeof(size_t));
+    size_t* end = (size_t*)malloc((num_blocks > 0 ? num_blocks : 1) * sizeof(size_t));
+    for(int b = 0; b < num_blocks; b++) {
+        blocks[b] = &TCB[thread_id].local_array[(size_t)b * PHASE1_BLOCK_SIZE];
     }
-    
-    // b. partition the sorted data using the pivots (for each thread)
-    for(int i = 0; i < local_n; i++) {
-        int value = local_data[i];
-        int partition_num = 0;
-        // figure out which partition this element goes into
-        for(int p = 0; p < num_pivots; p++) {
-            if(value > pivots[p]) {
-                partition_num++;
-            } else {
-                break;  // found the right partition
-            }
+    for(int p = 0; p < num_threads; p++) {
+        for(int b = 0; b < num_blocks; b++) {
+            start[b] = bounds[(size_t)b * (num_threads + 1) + p];
+            end[b] = bounds[(size_t)b * (num_threads + 1) + p + 1];
         }
-        // put value into correct partition
-        int idx = partition_sizes[thread_id][partition_num];
-        partitions[thread_id][partition_num][idx] = value;
-        partition_sizes[thread_id][partition_num]++;
+        size_t size = partition_sizes[thread_id][p];
+        partitions[thread_id][p] = (int*)malloc((size > 0 ? size : 1) * sizeof(int));
+        kway_merge(blocks, start, end, num_blocks, partitions[thread_id][p]);
     }
     
+    free(start);
+    free(end);
+    free(blocks);
+    free(bounds);
+    TCB[thread_id].block_bounds = NULL;
+    
     BARRIER;
 }
 
@@ -125,7 +267,7 @@ void phase3_partition(int thread_id) {
 void phase4_merge(int thread_id) {
     // thread i gets partition i from all p threads and merges them
     // calcuate total elements this thread will handle
-    int total_size = 0;
+    size_t total_size = 0;
     for(int t = 0; t < num_threads; t++) {
         total_size += partition_sizes[t][thread_id];
     } 
@@ -136,9 +278,9 @@ void phase4_merge(int thread_id) {
 
     // merge all the partitions together   (i took help from this source. citation: https://www.geeksforgeeks.org/dsa/merge-k-sorted-arrays/)
     // we need an array to track our position in each partition
-    int* position = (int*)calloc(num_threads, sizeof(int));
+    size_t* position = (size_t*)calloc(num_threads, sizeof(size_t));
     // keep adding elements to output until we've merged everything
-    for(int i = 0; i < total_size; i++) {
+    for(size_t i = 0; i < total_size; i++) {
         // step 1: find the smallest element among all partitions
         int min_value = 0;
         int from_which_thread = -1;
@@ -146,8 +288,8 @@ void phase4_merge(int thread_id) {
         // look at each thread's partition
         for(int t = 0; t < num_threads; t++) {
             // check if this partition still has elements
-            int size = partition_sizes[t][thread_id];
-            int pos = position[t];
+            size_t size = partition_sizes[t][thread_id];
+            size_t pos = position[t];
             
             if(pos < size) {
                 // get the current element from this partition
@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <sys/time.h>
 #include "pthread_barrier.h"
 #include "psrs_internal.h"
@@ -9,6 +11,79 @@ int compare_ints(const void* a, const void* b) {
     return (*(int*)a - *(int*)b);
 }
 
+// first index in run[0..n) with value > pivot (all elements <= pivot go to the lower partition, same as phase 3)
+size_t upper_bound_int(int* run, size_t n, int pivot) {
+    size_t lo = 0, hi = n;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(run[mid] <= pivot) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// kway_merge heap: each node is one unsigned 64 bit key = (value << 32) | run, so ordering nodes is a single
+// compare (value first, run breaks ties) and a node is only 8 bytes. the value's sign bit is flipped so
+// unsigned order matches int order (and nothing negative gets shifted)
+#define HEAP_KEY(value, run) (((unsigned long long)((unsigned int)(value) ^ 0x80000000u) << 32) | (unsigned int)(run))
+#define HEAP_VALUE(key) ((int)((unsigned int)((key) >> 32) ^ 0x80000000u))
+#define HEAP_RUN(key) ((int)((key) & 0xffffffff))
+
+// move heap[i] down by pulling smaller children up into the hole
+static void heap_sift_down(unsigned long long* heap, int heap_size, int i) {
+    unsigned long long node = heap[i];
+    int child;
+    while((child = 2 * i + 1) < heap_size) {
+        child += (heap[child + 1] < heap[child]);  // no branch here (heap[heap_size] is ULLONG_MAX so this is always safe)
+        if(heap[child] >= node) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = node;
+}
+
+// merge the sorted pieces runs[r][start[r]..end[r]) of k runs into out using a min heap
+// (start[] is advanced as elements are used up). the heap is k * 8 bytes so it stays in L1 while
+// the runs are read front to back, which is what keeps this cache friendly
+// (citation: heap approach from https://www.geeksforgeeks.org/dsa/merge-k-sorted-arrays/)
+void kway_merge(int** runs, size_t* start, size_t* end, int k, int* out) {
+    unsigned long long* heap = (unsigned long long*)malloc((k + 1) * sizeof(unsigned long long));
+    int heap_size = 0;
+    for(int r = 0; r < k; r++) {
+        if(start[r] < end[r]) {
+            heap[heap_size++] = HEAP_KEY(runs[r][start[r]], r);
+        }
+    }
+    heap[heap_size] = ULLONG_MAX;
+    for(int i = heap_size / 2 - 1; i >= 0; i--) {
+        heap_sift_down(heap, heap_size, i);
+    }
+    
+    while(heap_size > 1) {
+        int r = HEAP_RUN(heap[0]);
+        *out++ = HEAP_VALUE(heap[0]);
+        start[r]++;
+        if(start[r] < end[r]) {
+            heap[0] = HEAP_KEY(runs[r][start[r]], r);  // replace top with next element of the same run
+        } else {
+            heap[0] = heap[--heap_size];  // this run's piece is done
+            heap[heap_size] = ULLONG_MAX;
+        }
+        heap_sift_down(heap, heap_size, 0);
+    }
+    // only one piece left, just copy the rest of it
+    if(heap_size == 1) {
+        int r = HEAP_RUN(heap[0]);
+        memcpy(out, &runs[r][start[r]], (end[r] - start[r]) * sizeof(int));
+        start[r] = end[r];
+    }
+    
+    free(heap);
+}
+
 // helper to get current time
 static double get_wall_time() {
     struct timeval tv;
@@ -32,24 +107,67 @@ void* spmd_main(void* arg) {
         phase1_time = end_time - start_time;
     }
     
+    // phase 2 & the phase 3 split get redone with more oversampling if partitions come out too unbalanced
+    // (partition sizes are known from the split points, so nothing is merged until the pivots are final)
+    double p2_total = 0.0, p3_total = 0.0;
+    int resample;
+    do {
+        if(my_id == 0) start_time = get_wall_time();
+        phase2_select_pivots(my_id);
+        BARRIER;
+        if(my_id == 0) {
+            end_time = get_wall_time();
+            p2_total += end_time - start_time;
+        }
+        
+        if(my_id == 0) start_time = get_wall_time();
+        phase3_split_blocks(my_id);
+        resample = phase3_check_balance(my_id);
+        if(resample) phase3_free_split(my_id);
+        if(my_id == 0) {
+            end_time = get_wall_time();
+            p3_total += end_time - start_time;
+        }
+    } while(resample);
+    
     if(my_id == 0) start_time = get_wall_time();
-    phase2_select_pivots(my_id);
+    phase3_partition(my_id);
+    if(my_id == 0) {
+        end_time = get_wall_time();
+        phase2_time = p2_total;
+        phase3_time = p3_total + (end_time - start_time);
+    }
+    
+    if(my_id == 0) start_time = get_wall_time();
+    phase4_merge(my_id);
     BARRIER;
     if(my_id == 0) {
         end_time = get_wall_time();
-        phase2_time = end_time - start_time;
+        phase4_time = end_time - start_time;
     }
     
+    return NULL;
+}
+
+// SPMD main for psrs_merge_runs (runs are already sorted so no phase 1)
+// timings: phase2 = pivot selection, phase4 = split + merge (phase3 search is done inside the merge step)
+void* merge_spmd_main(void* arg) {
+    struct ThreadControlBlock* my_tcb = (struct ThreadControlBlock*)arg;
+    int my_id = my_tcb->id;
+    double start_time, end_time;
+    
+    BARRIER;  // sync all threads at start
+    
     if(my_id == 0) start_time = get_wall_time();
-    phase3_partition(my_id);
+    merge_select_pivots(my_id);
     BARRIER;
     if(my_id == 0) {
         end_time = get_wall_time();
-        phase3_time = end_time - start_time;
+        phase2_time = end_time - start_time;
     }
     
     if(my_id == 0) start_time = get_wall_time();
-    phase4_merge(my_id);
+    merge_split_and_merge(my_id);
     BARRIER;
     if(my_id == 0) {
         end_time = get_wall_time();
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include "sort.h"
 
 int comparison(const void* a, const void * b) {
     int value_a, value_b;
@@ -8,7 +9,7 @@ int comparison(const void* a, const void * b) {
     return value_a - value_b;
 }
 
-int* sort(int*arr, int sizeofarray) {
+int* sort(int*arr, size_t sizeofarray) {
     // takes in array as pointer
     // returns array pointer
     int oneElementSize = sizeof(arr[0]);
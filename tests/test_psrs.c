@@ -0,0 +1,212 @@
+// tests for psrs (run with "make test")
+// 1. size_t index math at the 2^31 / 2^32 boundaries (without allocating arrays that big)
+// 2. small psrs / psrs_merge_runs sorts checked with verify_sorted_permutation
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include "pthread_barrier.h"
+#include "psrs_internal.h"
+#include "sort.h"
+#include "data_gen.h"
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if(!(cond)) { \
+        printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while(0)
+
+// sizes just around 2^31 and 2^32 (where int / 32 bit math would overflow)
+static const size_t boundary_sizes[] = {
+    (1ULL << 31) - 1, (1ULL << 31), (1ULL << 31) + 1,
+    (1ULL << 32) - 1, (1ULL << 32), (1ULL << 32) + 1
+};
+#define NUM_BOUNDARY_SIZES (sizeof(boundary_sizes) / sizeof(boundary_sizes[0]))
+
+static void test_mul_div() {
+    for(size_t s = 0; s < NUM_BOUNDARY_SIZES; s++) {
+        size_t n = boundary_sizes[s];
+        CHECK(mul_div(n - 1, n, n) == n - 1);  // n * n is way past 64 bits here
+        CHECK(mul_div(n, n, n) == n);
+        CHECK(mul_div(3, n, 4) == (3 * n) / 4);
+        CHECK(mul_div(n - 1, n + 1, n) == n - 1);   // (n^2 - 1) / n rounds down
+    }
+    CHECK(mul_div(1ULL << 40, 1ULL << 40, 1ULL << 41) == 1ULL << 39);
+}
+
+// chunks of every thread must cover [0, n) exactly, blocks must cover every chunk exactly
+static void test_chunk_and_block_math() {
+    int thread_counts[] = {1, 3, 4, 7, 128};
+    for(size_t s = 0; s < NUM_BOUNDARY_SIZES; s++) {
+        size_t n = boundary_sizes[s];
+        for(int c = 0; c < (int)(sizeof(thread_counts) / sizeof(thread_counts[0])); c++) {
+            int p = thread_counts[c];
+            size_t expected_start = 0;
+            for(int t = 0; t < p; t++) {
+                size_t start = chunk_start(t, n, p);
+                size_t end = chunk_end(t, n, p);
+                CHECK(start == expected_start);
+                CHECK(end >= start);
+                expected_start = end;
+                
+                size_t local_n = end - start;
+                size_t num_blocks = chunk_num_blocks(local_n);
+                CHECK(num_blocks * PHASE1_BLOCK_SIZE >= local_n);
+                CHECK(num_blocks == 0 || (num_blocks - 1) * PHASE1_BLOCK_SIZE < local_n);
+                size_t last = block_length(num_blocks - 1, local_n);
+                CHECK(last > 0 && last <= PHASE1_BLOCK_SIZE);
+                CHECK((num_blocks - 1) * PHASE1_BLOCK_SIZE + last == local_n);
+            }
+            CHECK(expected_start == n);
+        }
+    }
+}
+
+// phase 2 sample indexes must stay inside their block / candidate list
+static void test_sample_index_math() {
+    size_t sample_counts[] = {1, 2, 128, 65536, 1ULL << 20};
+    for(size_t s = 0; s < NUM_BOUNDARY_SIZES; s++) {
+        size_t local_n = boundary_sizes[s];
+        size_t num_blocks = chunk_num_blocks(local_n);
+        for(size_t c = 0; c < sizeof(sample_counts) / sizeof(sample_counts[0]); c++) {
+            size_t num_samples = sample_counts[c];
+            size_t total_candidates = chunk_candidates(num_samples, num_blocks);
+            CHECK(total_candidates >= num_samples);
+
+            // every block but the last is full, the candidate buffer has total_candidates + num_blocks room
+            size_t last_block_n = block_length(num_blocks - 1, local_n);
+            size_t full_count = block_candidates(PHASE1_BLOCK_SIZE, total_candidates, local_n);
+            size_t last_count = block_candidates(last_block_n, total_candidates, local_n);
+            size_t num_candidates = full_count * (num_blocks - 1) + last_count;
+            CHECK(num_candidates >= num_samples);
+            CHECK(num_candidates <= total_candidates + num_blocks);
+
+            // last candidate of the first block and of the last (shortest) block
+            CHECK(mul_div((full_count - 1) * num_blocks, PHASE1_BLOCK_SIZE, full_count * num_blocks) < PHASE1_BLOCK_SIZE);
+            CHECK(mul_div((last_count - 1) * num_blocks + num_blocks - 1, last_block_n, last_count * num_blocks) < last_block_n);
+            CHECK(mul_div(num_samples - 1, num_candidates, num_samples) < num_candidates);
+            
+            // old phase 2 formula on the whole chunk
+            CHECK(mul_div(num_samples - 1, local_n, num_samples) < local_n);
+        }
+    }
+}
+
+// upper_bound_int on an array bigger than 2^32 elements: mmap it without reserving memory, only the pages
+// the binary search touches (plus the one we write) get real memory. untouched pages read as 0
+static void test_upper_bound_big() {
+    size_t n = (1ULL << 32) + 1;
+    int* arr = (int*)mmap(NULL, n * sizeof(int), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(arr == MAP_FAILED) {
+        printf("skip: could not map %zu ints for upper_bound_int test\n", n);
+        return;
+    }
+    arr[n - 1] = 1;  // array is 0, 0, ..., 0, 1
+    CHECK(upper_bound_int(arr, n, -1) == 0);
+    CHECK(upper_bound_int(arr, n, 0) == n - 1);
+    CHECK(upper_bound_int(arr, n, 1) == n);
+    CHECK(upper_bound_int(arr + 1, n - 1, 0) == n - 2);
+    munmap(arr, n * sizeof(int));
+}
+
+// kway_merge heap keys with negative values and the int extremes (sign bit is flipped inside the key)
+static void test_kway_merge_signed() {
+    int run0[] = {INT_MIN, -5, -1, 0, INT_MAX};
+    int run1[] = {INT_MIN, -2, 3, INT_MAX};
+    int run2[] = {-7, -1, 1};
+    int* runs[] = {run0, run1, run2};
+    size_t start[] = {0, 0, 0};
+    size_t end[] = {5, 4, 3};
+    int expected[] = {INT_MIN, INT_MIN, -7, -5, -2, -1, -1, 0, 1, 3, INT_MAX, INT_MAX};
+    int out[12];
+    kway_merge(runs, start, end, 3, out);
+    for(int i = 0; i < 12; i++) {
+        CHECK(out[i] == expected[i]);
+    }
+}
+
+static void test_psrs_small() {
+    size_t sizes[] = {0, 1, 7, 1000, 300001};
+    int thread_counts[] = {1, 2, 4, 7};
+    for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for(int c = 0; c < 4; c++) {
+            for(int d = DIST_UNIFORM; d <= DIST_NEARLY_SORTED; d++) {
+                size_t n = sizes[s];
+                int* arr = make_input_array(n, (enum InputDistribution)d, 42, 2);
+                unsigned long long hash = multiset_hash(arr, n, 2);
+                set_num_threads(thread_counts[c]);
+                psrs(arr, n);
+                CHECK(verify_sorted_permutation(arr, n, hash, 2));
+                free(arr);
+            }
+        }
+    }
+}
+
+static void test_merge_runs_small() {
+    int run_counts[] = {1, 3, 8, 16};
+    int thread_counts[] = {1, 2, 4, 7};
+    size_t n = 200003;
+    for(int a = 0; a < 4; a++) {
+        for(int c = 0; c < 4; c++) {
+            int k = run_counts[a];
+            int* arr = make_input_array(n, DIST_UNIFORM, 7, 2);
+            unsigned long long hash = multiset_hash(arr, n, 2);
+            int** runs = (int**)malloc(k * sizeof(int*));
+            size_t* run_sizes = (size_t*)malloc(k * sizeof(size_t));
+            for(int r = 0; r < k; r++) {
+                // uneven runs: run r gets a share proportional to r + 1
+                size_t run_start = mul_div((size_t)r * (r + 1) / 2, n, (size_t)k * (k + 1) / 2);
+                size_t run_end = mul_div((size_t)(r + 1) * (r + 2) / 2, n, (size_t)k * (k + 1) / 2);
+                runs[r] = &arr[run_start];
+                run_sizes[r] = run_end - run_start;
+                sort(runs[r], run_sizes[r]);
+            }
+            int* merged = (int*)malloc(n * sizeof(int));
+            set_num_threads(thread_counts[c]);
+            psrs_merge_runs(runs, run_sizes, k, merged);
+            CHECK(verify_sorted_permutation(merged, n, hash, 2));
+            free(merged);
+            free(runs);
+            free(run_sizes);
+            free(arr);
+        }
+    }
+    
+    // empty merge right after a psrs run: stats and timings must not be left over from that run
+    size_t n_small = 1000;
+    int* arr = make_input_array(n_small, DIST_FEW_UNIQUE, 3, 2);
+    set_num_threads(4);
+    psrs(arr, n_small);
+    size_t empty_size = 0;
+    int* empty_runs[] = {arr};
+    psrs_merge_runs(empty_runs, &empty_size, 1, arr);
+    double imbalance, p1, p2, p3, p4;
+    int oversampling_used;
+    get_balance_stats(&imbalance, &oversampling_used);
+    get_phase_times(&p1, &p2, &p3, &p4);
+    CHECK(imbalance == 1.0);
+    CHECK(p1 == 0.0 && p3 == 0.0);
+    free(arr);
+}
+
+int main() {
+    test_mul_div();
+    test_chunk_and_block_math();
+    test_sample_index_math();
+    test_upper_bound_big();
+    test_kway_merge_signed();
+    test_psrs_small();
+    test_merge_runs_small();
+    
+    if(failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("all tests passed\n");
+    return 0;
+}